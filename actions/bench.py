@@ -0,0 +1,414 @@
+#!/usr/bin/env python3
+"""Load generators for the throwaway cluster started by cluster.sh.
+
+Each subcommand drives one kind of load against the running cluster and
+prints a JSON report on stdout.
+"""
+
+import argparse
+import json
+import os
+import re
+import subprocess
+import sys
+import time
+import urllib.request
+from concurrent.futures import ThreadPoolExecutor
+
+
+def run(*cmd):
+    subprocess.run(cmd, check=True, stdout=subprocess.DEVNULL)
+
+
+def timed(*cmd):
+    """Run a command and return its wall-clock time in milliseconds."""
+    start = time.monotonic()
+    run(*cmd)
+    return (time.monotonic() - start) * 1000
+
+
+def percentiles(samples):
+    samples = sorted(samples)
+
+    def pick(q):
+        return round(samples[min(len(samples) - 1, int(q * len(samples)))], 3)
+
+    return {"count": len(samples), "p50": pick(0.50), "p90": pick(0.90),
+            "p99": pick(0.99), "max": round(samples[-1], 3)}
+
+
+def number(value):
+    """Unwrap the {"set", "number"} objects newer data_parser versions use."""
+    if isinstance(value, dict):
+        return value.get("number")
+    return value
+
+
+def sdiag():
+    out = subprocess.run(["sdiag", "--json"], check=True,
+                         capture_output=True, text=True).stdout
+    return json.loads(out)["statistics"]
+
+
+def queued_jobs():
+    out = subprocess.run(["squeue", "-h", "-o", "%i"], check=True,
+                         capture_output=True, text=True).stdout
+    return len(out.split())
+
+
+def ctld(args):
+    """Controller RPC throughput and scheduling latency."""
+    run("sdiag", "--reset")
+
+    def submit(i):
+        return timed("sbatch", "--quiet", "-N", str(i % args.nodes + 1),
+                     "-t", "1", "--wrap", "true")
+
+    start = time.monotonic()
+    with ThreadPoolExecutor(args.clients) as pool:
+        submit_ms = list(pool.map(submit, range(args.jobs)))
+    submitted = time.monotonic() - start
+
+    # Keep squeue and sacct traffic going while the queue drains, the way
+    # users polling their jobs would.
+    squeue_ms, sacct_ms = [], []
+    deadline = time.monotonic() + args.timeout
+    with ThreadPoolExecutor(args.clients) as pool:
+        while queued_jobs():
+            if time.monotonic() > deadline:
+                sys.exit(f"queue did not drain within {args.timeout}s")
+            squeue_ms += pool.map(lambda _: timed("squeue", "-h"),
+                                  range(args.clients))
+            sacct_ms += pool.map(lambda _: timed("sacct", "-n", "-X"),
+                                 range(args.clients))
+    drained = time.monotonic() - start
+
+    stats = sdiag()
+    return {
+        "jobs": args.jobs,
+        "submit_jobs_per_sec": round(args.jobs / submitted, 1),
+        "completed_jobs_per_sec": round(args.jobs / drained, 1),
+        "sbatch_latency_ms": percentiles(submit_ms),
+        "squeue_latency_ms": percentiles(squeue_ms),
+        "sacct_latency_ms": percentiles(sacct_ms),
+        "schedule_cycle_mean_us": number(stats.get("schedule_cycle_mean")),
+        "schedule_cycle_max_us": number(stats.get("schedule_cycle_max")),
+        "backfill_cycle_mean_us": number(stats.get("bf_cycle_mean")),
+        "backfill_cycle_max_us": number(stats.get("bf_cycle_max")),
+        "rpcs": {
+            rpc["message_type"]: {
+                "count": number(rpc["count"]),
+                "average_us": number(rpc["average_time"]),
+            }
+            for rpc in stats.get("rpcs_by_message_type", [])
+        },
+    }
+
+
+def dbd(args):
+    """slurmdbd ingest rate for a backlog of job records."""
+    # Hold slurmdbd down while the jobs run so their records pile up in
+    # slurmctld's DBD agent queue, then time how fast slurmdbd drains it.
+    run("pkill", "-x", "slurmdbd")
+    while subprocess.run(["pgrep", "-x", "slurmdbd"],
+                         stdout=subprocess.DEVNULL).returncode == 0:
+        time.sleep(0.5)
+
+    run("sbatch", "--quiet", f"--array=1-{args.jobs}", "-t", "1",
+        "--wrap", "true")
+    deadline = time.monotonic() + args.timeout
+    while queued_jobs():
+        if time.monotonic() > deadline:
+            sys.exit(f"queue did not drain within {args.timeout}s")
+        time.sleep(1)
+    backlog = number(sdiag()["dbd_agent_queue_size"])
+
+    run("slurmdbd")
+    start = time.monotonic()
+    depth = [backlog]
+    while depth[-1]:
+        if time.monotonic() > deadline:
+            sys.exit(f"DBD agent queue did not drain within {args.timeout}s")
+        time.sleep(0.5)
+        depth.append(number(sdiag()["dbd_agent_queue_size"]))
+    elapsed = time.monotonic() - start
+
+    return {
+        "jobs": args.jobs,
+        "queued_records": backlog,
+        "records_per_sec": round(backlog / elapsed, 1),
+        "drain_seconds": round(elapsed, 1),
+        "queue_depth_samples": depth,
+    }
+
+
+def restd(args):
+    """slurmrestd request rate against the jobs endpoint."""
+    with ThreadPoolExecutor(args.clients) as pool:
+        list(pool.map(lambda _: run("sbatch", "--quiet", "--hold",
+                                    "--wrap", "true"), range(args.jobs)))
+    request = urllib.request.Request(
+        f"http://127.0.0.1:6820/slurm/{args.api}/jobs",
+        headers={"X-SLURM-USER-NAME": "root",
+                 "X-SLURM-USER-TOKEN": os.environ["SLURM_JWT"]})
+
+    def client(_):
+        samples = []
+        end = time.monotonic() + args.seconds
+        while time.monotonic() < end:
+            start = time.monotonic()
+            with urllib.request.urlopen(request) as response:
+                response.read()
+            samples.append((time.monotonic() - start) * 1000)
+        return samples
+
+    with ThreadPoolExecutor(args.clients) as pool:
+        request_ms = [ms for samples in pool.map(client, range(args.clients))
+                      for ms in samples]
+    run("scancel", "--user=root")
+
+    return {
+        "endpoint": request.full_url,
+        "pending_jobs": args.jobs,
+        "requests_per_sec": round(len(request_ms) / args.seconds, 1),
+        "latency_ms": percentiles(request_ms),
+    }
+
+
+def steps(args):
+    """srun step launch latency inside a single allocation."""
+    out = subprocess.run(["salloc", "--no-shell", "-N", "1", "-n", "1"],
+                         check=True, capture_output=True, text=True).stderr
+    job = re.search(r"Granted job allocation (\d+)", out).group(1)
+
+    start = time.monotonic()
+    launch_ms = [timed("srun", f"--jobid={job}", "-n", "1", "true")
+                 for _ in range(args.steps)]
+    elapsed = time.monotonic() - start
+    run("scancel", job)
+
+    out = subprocess.run(["scontrol", "show", "config"], check=True,
+                         capture_output=True, text=True).stdout
+    config = dict(re.findall(r"^(\w+)\s+= (.*)$", out, re.MULTILINE))
+    return {
+        "plugins": args.plugins,
+        "proctrack": config.get("ProctrackType"),
+        "task": config.get("TaskPlugin"),
+        "mpi": config.get("MpiDefault"),
+        "steps": args.steps,
+        "steps_per_sec": round(args.steps / elapsed, 1),
+        "launch_latency_ms": percentiles(launch_ms),
+    }
+
+
+def profile(args):
+    """slurmstepd CPU time and HDF5 output per profiling frequency."""
+    ticks = os.sysconf("SC_CLK_TCK")
+
+    def stepd_cpu_ms():
+        pids = subprocess.run(["pgrep", "-f", r"^slurmstepd: \[[0-9]+\.0\]"],
+                              capture_output=True, text=True).stdout.split()
+        if not pids:
+            return None
+        with open(f"/proc/{pids[0]}/stat") as stat:
+            fields = stat.read().rsplit(")", 1)[1].split()
+        return (int(fields[11]) + int(fields[12])) * 1000 / ticks
+
+    def profile_bytes():
+        return sum(os.path.getsize(os.path.join(root, name))
+                   for root, _, names in os.walk(args.profile_dir)
+                   for name in names)
+
+    results = {}
+    for freq in args.frequencies:
+        opts = ["--profile=none"]
+        if freq:
+            opts = ["--profile=task", f"--acctg-freq=task={freq},network={freq}"]
+        if freq and args.network:
+            opts[0] += ",network"
+        before = profile_bytes()
+        step = subprocess.Popen(["srun", "-n", "1", *opts, "sleep",
+                                 str(args.seconds)])
+        # A step's CPU time only grows, so the last reading before it
+        # exits is the total.
+        cpu_ms = 0
+        while step.poll() is None:
+            cpu_ms = stepd_cpu_ms() or cpu_ms
+            time.sleep(0.5)
+        if step.returncode:
+            sys.exit(f"srun {' '.join(opts)} failed")
+        results[f"every_{freq}s" if freq else "off"] = {
+            "stepd_cpu_ms": round(cpu_ms, 1),
+            "stepd_cpu_percent": round(cpu_ms / (args.seconds * 10), 3),
+            "hdf5_bytes_per_minute": round((profile_bytes() - before)
+                                           * 60 / args.seconds),
+        }
+    return {"seconds": args.seconds, "network": args.network,
+            "frequencies": results}
+
+
+def responding(*cmd):
+    return subprocess.run(cmd, stdout=subprocess.DEVNULL,
+                          stderr=subprocess.DEVNULL).returncode == 0
+
+
+def wait_until(check, timeout, what):
+    """Wait for check() to hold and return how long that took in seconds."""
+    start = time.monotonic()
+    while not check():
+        if time.monotonic() - start > timeout:
+            sys.exit(f"{what} within {timeout}s")
+        time.sleep(0.2)
+    return round(time.monotonic() - start, 2)
+
+
+def memory_kb(name):
+    pid = subprocess.run(["pgrep", "-x", name], check=True,
+                         capture_output=True, text=True).stdout.split()[0]
+    with open(f"/proc/{pid}/status") as status:
+        fields = dict(line.split(":", 1) for line in status)
+    return {key: int(fields[key].split()[0]) for key in ("VmRSS", "VmHWM")}
+
+
+def scale(args):
+    """slurmctld startup, reconfigure and registration with many nodes."""
+    # Nodes keep their saved state across restarts, so count registrations
+    # rather than idle nodes to tell when every slurmd has checked in.
+    def registered():
+        return sum(number(rpc["count"])
+                   for rpc in sdiag().get("rpcs_by_message_type", [])
+                   if rpc["message_type"] == "MESSAGE_NODE_REGISTRATION_STATUS"
+                   ) >= args.live
+
+    def ctld_up():
+        return responding("scontrol", "ping")
+
+    results = {"live_nodes": args.live, "memory_kb_booted": memory_kb("slurmctld")}
+
+    # Restart on the saved state, the way a controller failover would.
+    run("scontrol", "shutdown", "slurmctld")
+    wait_until(lambda: not responding("pgrep", "-x", "slurmctld"),
+               args.timeout, "slurmctld did not stop")
+    start = time.monotonic()
+    run("slurmctld")
+    results["startup_seconds"] = wait_until(ctld_up, args.timeout,
+                                            "slurmctld did not answer")
+    wait_until(registered, args.timeout, "nodes did not register after the restart")
+    results["startup_to_registered_seconds"] = round(time.monotonic() - start, 2)
+
+    # In current releases reconfigure re-execs slurmctld, so time until it
+    # answers again.
+    start = time.monotonic()
+    run("scontrol", "reconfigure")
+    time.sleep(0.2)
+    wait_until(ctld_up, args.timeout, "slurmctld did not answer after reconfigure")
+    results["reconfigure_seconds"] = round(time.monotonic() - start, 2)
+
+    # Restart every live slurmd at once so their registrations all land on
+    # the controller together.
+    run("sdiag", "--reset")
+    run("pkill", "-x", "slurmd")
+    wait_until(lambda: not responding("pgrep", "-x", "slurmd"),
+               args.timeout, "slurmd did not stop")
+    start = time.monotonic()
+    with ThreadPoolExecutor(args.clients) as pool:
+        list(pool.map(lambda i: run("slurmd", "-N", f"ci{i}"),
+                      range(1, args.live + 1)))
+    wait_until(registered, args.timeout, "nodes did not register")
+    results["registration_storm_seconds"] = round(time.monotonic() - start, 2)
+
+    # The controller keeps pinging the nodes without a slurmd through the
+    # TreeWidth fanout; watch the agent while node queries come in.
+    agent_queue, agent_threads, sinfo_ms = [], [], []
+    end = time.monotonic() + args.seconds
+    while time.monotonic() < end:
+        stats = sdiag()
+        agent_queue.append(number(stats["agent_queue_size"]))
+        agent_threads.append(number(stats["agent_thread_count"]))
+        sinfo_ms.append(timed("sinfo", "-h", "-N"))
+
+    stats = sdiag()
+    results.update({
+        "agent_queue_size_max": max(agent_queue),
+        "agent_thread_count_max": max(agent_threads),
+        "sinfo_node_list_ms": percentiles(sinfo_ms),
+        "registration_rpcs": {
+            rpc["message_type"]: {
+                "count": number(rpc["count"]),
+                "average_us": number(rpc["average_time"]),
+            }
+            for rpc in stats.get("rpcs_by_message_type", [])
+            if "REGISTRATION" in rpc["message_type"]
+        },
+        "memory_kb": memory_kb("slurmctld"),
+    })
+    return results
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__)
+    parser.add_argument("--nodes", type=int, default=1)
+    parser.add_argument("--flavor", default="default")
+    parser.add_argument("--slurm-version", default="")
+    parser.add_argument("--clients", type=int, default=16,
+                        help="concurrent client commands")
+    parser.add_argument("--timeout", type=int, default=1800,
+                        help="seconds to wait for the cluster to go idle")
+    sub = parser.add_subparsers(dest="benchmark", required=True)
+
+    p = sub.add_parser("ctld", help=ctld.__doc__)
+    p.add_argument("--jobs", type=int, default=10000)
+    p.set_defaults(func=ctld)
+
+    p = sub.add_parser("dbd", help=dbd.__doc__)
+    p.add_argument("--jobs", type=int, default=20000)
+    p.set_defaults(func=dbd)
+
+    p = sub.add_parser("restd", help=restd.__doc__)
+    p.add_argument("--api", default="v0.0.42")
+    p.add_argument("--jobs", type=int, default=1000,
+                   help="held jobs in the queue while polling")
+    p.add_argument("--seconds", type=int, default=60)
+    p.set_defaults(func=restd)
+
+    p = sub.add_parser("profile", help=profile.__doc__)
+    p.add_argument("--frequencies", type=int, nargs="+",
+                   default=[0, 30, 10, 5, 1],
+                   help="sampling intervals in seconds, 0 for profiling off")
+    p.add_argument("--seconds", type=int, default=120,
+                   help="length of each profiled step")
+    p.add_argument("--profile-dir", required=True)
+    p.add_argument("--network", action="store_true",
+                   default=os.path.isdir("/sys/class/infiniband")
+                   and bool(os.listdir("/sys/class/infiniband")),
+                   help="also sample OFED counters")
+    p.set_defaults(func=profile)
+
+    p = sub.add_parser("scale", help=scale.__doc__)
+    p.add_argument("--live", type=int, default=256,
+                   help="nodes that run a slurmd")
+    p.add_argument("--seconds", type=int, default=120,
+                   help="how long to watch the ping fanout")
+    p.set_defaults(func=scale)
+
+    p = sub.add_parser("steps", help=steps.__doc__)
+    p.add_argument("--steps", type=int, default=2000)
+    p.add_argument("--plugins", default="none",
+                   help="plugin combination the cluster was started with")
+    p.set_defaults(func=steps)
+
+    args = parser.parse_args()
+    report = {
+        "benchmark": args.benchmark,
+        "flavor": args.flavor,
+        "slurm_version": args.slurm_version,
+        "nodes": args.nodes,
+        "timestamp": int(time.time()),
+        "results": args.func(args),
+    }
+    json.dump(report, sys.stdout, indent=2)
+    print()
+
+
+if __name__ == "__main__":
+    main()
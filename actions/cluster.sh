@@ -0,0 +1,205 @@
+# Helpers for running a throwaway Slurm cluster inside the build container.
+# Everything runs as root on this host; sourced by entrypoint.sh.
+
+cluster_dir=/var/tmp/slurm-cluster
+
+# Install the named packages from the RPM set under a topdir.
+cluster_install() {
+    local topdir="$1" rpm pkgs=()
+    shift
+
+    for rpm in "$topdir"/RPMS/*/*.rpm; do
+        if printf '%s\n' "$@" | grep -qxF "$(rpm -qp --qf '%{NAME}' "$rpm")"; then
+            pkgs+=("$rpm")
+        fi
+    done
+    dnf install -y "${pkgs[@]}"
+}
+
+# Remove every installed slurm package again.
+cluster_uninstall() {
+    dnf remove -y 'slurm*'
+}
+
+# Start MariaDB and slurmdbd, and register the cluster for accounting.
+cluster_start_dbd() {
+    local host="$1" i
+    # InnoDB settings from the Slurm accounting guide.
+    cat > /etc/my.cnf.d/slurm.cnf <<CONF
+[mysqld]
+innodb_buffer_pool_size=1024M
+innodb_log_file_size=64M
+innodb_lock_wait_timeout=900
+CONF
+    rm -rf /var/lib/mysql
+    mariadb-install-db --user=mysql > /dev/null
+    mariadbd-safe --user=mysql > /dev/null &
+    until mariadb-admin ping > /dev/null 2>&1; do
+        sleep 1
+    done
+
+    cat > /etc/slurm/slurmdbd.conf <<CONF
+AuthType=auth/munge
+DbdHost=$host
+SlurmUser=root
+PidFile=$cluster_dir/slurmdbd.pid
+LogFile=$cluster_dir/log/slurmdbd.log
+StorageType=accounting_storage/mysql
+StorageHost=localhost
+StorageUser=root
+StorageLoc=slurm_acct_db
+CONF
+    chmod 600 /etc/slurm/slurmdbd.conf
+
+    slurmdbd
+    for i in $(seq 1 60); do
+        sacctmgr -i add cluster ci > /dev/null 2>&1 && return 0
+        sleep 1
+    done
+    echo "slurmdbd did not come up" >&2
+    cat "$cluster_dir/log/slurmdbd.log" >&2
+    return 1
+}
+
+# Move every process out of the container's cgroup root and enable its
+# controllers for the subtree, which cgroup/v2 needs to create job cgroups.
+# The kernel refuses the latter while any process is left in the root.
+cluster_cgroup_delegate() {
+    local root=/sys/fs/cgroup pid
+
+    mkdir -p "$root/init"
+    while read -r pid; do
+        echo "$pid" > "$root/init/cgroup.procs" 2> /dev/null || true
+    done < "$root/cgroup.procs"
+    sed 's/[^ ]*/+&/g' "$root/cgroup.controllers" > "$root/cgroup.subtree_control"
+}
+
+# Start munge, optionally accounting ("dbd"), slurmctld and one slurmd per
+# emulated node. More than one node needs a build with --with multiple_slurmd.
+# The third argument is a comma list of step plugins to enable on top of the
+# bare defaults: cgroup (cgroup/v2, needs a privileged container), affinity,
+# pmix, and profile (HDF5 task profiling, plus OFED counters when the host
+# has InfiniBand devices). The fourth limits how many of the nodes get a
+# slurmd, leaving the rest configured but never responding.
+cluster_start() {
+    local nodes="${1:-1}" accounting="${2:-}" plugins=",${3:-},"
+    local live="${4:-$nodes}"
+    local host port="" storage="" proctrack=proctrack/linuxproc tasks=()
+    local mpi=none cgroup=disabled devices=no jobacct=jobacct_gather/none profile=""
+    host="$(hostname -s)"
+
+    if [[ $plugins == *,cgroup,* ]]; then
+        proctrack=proctrack/cgroup cgroup=cgroup/v2 devices=yes
+        tasks+=(task/cgroup)
+        cluster_cgroup_delegate
+    fi
+    [[ $plugins != *,affinity,* ]] || tasks+=(task/affinity)
+    [[ $plugins != *,pmix,* ]] || mpi=pmix
+    if [[ $plugins == *,profile,* ]]; then
+        jobacct=jobacct_gather/linux
+        profile="AcctGatherProfileType=acct_gather_profile/hdf5"
+        if compgen -G "/sys/class/infiniband/*" > /dev/null; then
+            profile+=$'\nAcctGatherInterconnectType=acct_gather_interconnect/ofed'
+        fi
+    fi
+
+    rm -rf "$cluster_dir"
+    mkdir -p "$cluster_dir/log" "$cluster_dir/state" /etc/slurm
+    [ "$nodes" -eq 1 ] || port="Port=17001-$((17000 + nodes))"
+    if [ "$accounting" = dbd ]; then
+        storage="AccountingStorageType=accounting_storage/slurmdbd
+AccountingStorageHost=$host"
+    fi
+
+    cat > /etc/slurm/slurm.conf <<CONF
+ClusterName=ci
+SlurmctldHost=$host
+SlurmUser=root
+AuthType=auth/munge
+AuthAltTypes=auth/jwt
+AuthAltParameters=jwt_key=$cluster_dir/jwt.key
+StateSaveLocation=$cluster_dir/state/slurmctld
+SlurmdSpoolDir=$cluster_dir/state/%n
+SlurmctldPidFile=$cluster_dir/slurmctld.pid
+SlurmdPidFile=$cluster_dir/slurmd-%n.pid
+SlurmctldLogFile=$cluster_dir/log/slurmctld.log
+SlurmdLogFile=$cluster_dir/log/slurmd-%n.log
+ProctrackType=$proctrack
+TaskPlugin=$(IFS=,; echo "${tasks[*]:-task/none}")
+JobAcctGatherType=$jobacct
+MpiDefault=$mpi
+$profile
+SchedulerType=sched/backfill
+SchedulerParameters=bf_interval=5
+SelectType=select/cons_tres
+SlurmdParameters=config_overrides
+ReturnToService=2
+MaxJobCount=200000
+MaxArraySize=100001
+$storage
+NodeName=ci[1-$nodes] NodeHostname=$host NodeAddr=127.0.0.1 CPUs=64 RealMemory=256000 $port
+PartitionName=ci Nodes=ALL Default=YES MaxTime=INFINITE State=UP
+CONF
+    printf 'CgroupPlugin=%s\nIgnoreSystemd=yes\nConstrainDevices=%s\n' "$cgroup" "$devices" \
+        > /etc/slurm/cgroup.conf
+    rm -f /etc/slurm/acct_gather.conf
+    if [ -n "$profile" ]; then
+        mkdir -p "$cluster_dir/profile"
+        printf 'ProfileHDF5Dir=%s\nProfileHDF5Default=None\n' "$cluster_dir/profile" \
+            > /etc/slurm/acct_gather.conf
+    fi
+
+    dd if=/dev/urandom of="$cluster_dir/jwt.key" bs=32 count=1 status=none
+    chmod 600 "$cluster_dir/jwt.key"
+    mungekey --create --force
+    munged --force
+    # Only read by binaries from the tsan flavor.
+    export TSAN_OPTIONS="log_path=$cluster_dir/log/tsan halt_on_error=0 second_deadlock_stack=1"
+    [ "$accounting" != dbd ] || cluster_start_dbd "$host"
+
+    slurmctld
+    local i
+    for i in $(seq 1 "$live"); do
+        slurmd -N "ci$i"
+    done
+
+    for i in $(seq 1 60); do
+        [ "$(sinfo -h -N -t idle -o %N | wc -l)" -ge "$live" ] && return 0
+        sleep 1
+    done
+    echo "Cluster did not come up with $live idle nodes" >&2
+    cat "$cluster_dir"/log/*.log >&2
+    return 1
+}
+
+# Start slurmrestd on port 6820 with JWT auth, and export a token for root in
+# SLURM_JWT. slurmrestd refuses to run as root, so it drops to nobody.
+cluster_start_restd() {
+    SLURM_JWT=daemon slurmrestd -a rest_auth/jwt -u nobody -g nobody \
+        127.0.0.1:6820 > "$cluster_dir/log/slurmrestd.log" 2>&1 &
+    export "$(scontrol token username=root lifespan=7200)"
+
+    local i
+    for i in $(seq 1 60); do
+        curl -sf -H "X-SLURM-USER-NAME: root" -H "X-SLURM-USER-TOKEN: $SLURM_JWT" \
+            http://127.0.0.1:6820/slurm/v0.0.42/ping > /dev/null && return 0
+        sleep 1
+    done
+    echo "slurmrestd did not come up" >&2
+    cat "$cluster_dir/log/slurmrestd.log" >&2
+    return 1
+}
+
+# Shut the cluster down cleanly so the daemons run their exit handlers.
+cluster_stop() {
+    pkill -x slurmrestd || true
+    scontrol shutdown
+    while pgrep -x 'slurmctld|slurmd' > /dev/null; do
+        sleep 1
+    done
+    if pgrep -x slurmdbd > /dev/null; then
+        pkill -x slurmdbd
+        mariadb-admin shutdown
+    fi
+    pkill -x munged || true
+}
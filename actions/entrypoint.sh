@@ -1,5 +1,643 @@
 #!/usr/bin/env bash
+set -euo pipefail
 
-wget https://download.schedmd.com/slurm/slurm-25.05.3.tar.bz2
+source "$(dirname "$0")/cluster.sh"
 
-rpmbuild -ta slurm-25.05.3.tar.bz2
+slurm_version="${SLURM_VERSION:-25.05.3}"
+slurm_ref="${SLURM_REF:-}"
+allow_unpinned="${ALLOW_UNPINNED:-false}"
+tarball="slurm-${slurm_version}.tar.bz2"
+flavor="${FLAVOR:-default}"
+prefix="${PREFIX:-/usr}"
+libdir="$(rpm --define "_prefix $prefix" -E %_libdir)"
+make_jobs="${MAKE_JOBS:-$(nproc)}"
+zstd_level="${ZSTD_LEVEL:-}"
+zstd_threads="${ZSTD_THREADS:-0}"
+
+# Non-default flavors get their own topdir and dist tag so RPM sets built
+# side by side never overwrite or get mixed up with each other.
+if [ "$flavor" = default ]; then
+    topdir="$HOME/rpmbuild"
+    dist="$(rpm -E %dist)"
+else
+    topdir="$HOME/rpmbuild-$flavor"
+    dist="$(rpm -E %dist).${flavor//-/_}"
+fi
+spec="$topdir/SPECS/slurm.spec"
+source_cache="$HOME/.cache/slurm-sources"
+
+export PATH="$prefix/sbin:$prefix/bin:/usr/lib64/ccache:$PATH"
+export CCACHE_DIR="$HOME/.ccache"
+
+# Move files out of the base slurm package into slurm-<name>, so only the
+# nodes that install it pick up their size or extra runtime dependencies.
+split_files() {
+    local name="$1" summary="$2" requires="$3"
+    shift 3
+
+    local path
+    for path in "$@"; do
+        sed -i "s|^%{_libdir}/slurm/\*\.so$|&\n%exclude $path|" "$spec"
+        if ! grep -qxF "%exclude $path" "$spec"; then
+            echo "Cannot split $path out of the base package in $spec" >&2
+            exit 1
+        fi
+    done
+
+    {
+        echo
+        echo "%package $name"
+        echo "Summary: $summary"
+        echo "Requires: %{name}%{?_isa} = %{version}-%{release}"
+        [ -z "$requires" ] || echo "Requires: $requires"
+        echo "%description $name"
+        echo "$summary."
+        echo
+        echo "%files $name"
+        printf '%s\n' "$@"
+    } >> "$spec"
+}
+
+split_plugins() {
+    local name="$1" summary="$2" requires="$3" dir="%{_libdir}/slurm/"
+    shift 3
+    split_files "$name" "$summary" "$requires" "${@/#/$dir}"
+}
+
+# Fail early for flavors that only build on one architecture.
+require_arch() {
+    if [ "$(uname -m)" != "$1" ]; then
+        echo "The $flavor flavor only builds on $1" >&2
+        exit 1
+    fi
+}
+
+# Fetch the release tarball into a cache keyed on the sha256 pinned for it
+# in slurm.sha256sums, checking it against the pin on every use. A release
+# with no pin is refused unless allow-unpinned is set, and is then fetched
+# afresh each time since there is no sum to cache it under.
+fetch_tarball() {
+    local pinned sum url="https://download.schedmd.com/slurm/$tarball"
+    pinned="$(awk -v f="$tarball" '$2 == f { print $1 }' \
+        "$(dirname "$0")/slurm.sha256sums")"
+
+    if [ -z "$pinned" ]; then
+        if [ "$allow_unpinned" != true ]; then
+            echo "$tarball has no sha256 in slurm.sha256sums; pin SchedMD's published sum or set allow-unpinned" >&2
+            exit 1
+        fi
+        source_tarball="/var/tmp/slurm-unpinned/$tarball"
+        mkdir -p "${source_tarball%/*}"
+        wget -O "$source_tarball" "$url"
+        sum="$(sha256sum "$source_tarball" | cut -d' ' -f1)"
+        echo "::warning::$tarball is not pinned in slurm.sha256sums (sha256 $sum)"
+        return
+    fi
+
+    source_tarball="$source_cache/$pinned/$tarball"
+    if [ ! -f "$source_tarball" ]; then
+        mkdir -p "${source_tarball%/*}"
+        wget -O "$source_tarball.part" "$url"
+        mv "$source_tarball.part" "$source_tarball"
+    fi
+    sum="$(sha256sum "$source_tarball" | cut -d' ' -f1)"
+    if [ "$sum" != "$pinned" ]; then
+        rm -f "$source_tarball"
+        echo "$tarball has sha256 $sum, expected $pinned" >&2
+        exit 1
+    fi
+}
+
+# Build a release-style tarball from a ref in SchedMD's git repository,
+# named after the Source that the ref's own spec expects.
+archive_ref() {
+    local src=/var/tmp/slurm-ref/git
+
+    rm -rf "$src"
+    git clone --quiet --filter=blob:none https://github.com/SchedMD/slurm.git "$src"
+    git -C "$src" checkout --quiet "$slurm_ref"
+
+    tarball="$(rpmspec -P "$src/slurm.spec" | awk '$1 ~ /^Source0?:$/ { print $2; exit }')"
+    slurm_version="$(rpmspec -q --srpm --qf '%{VERSION}' "$src/slurm.spec")"
+    source_tarball="/var/tmp/slurm-ref/$tarball"
+    git -C "$src" archive --prefix="${tarball%.tar.bz2}/" HEAD \
+        | bzip2 > "$source_tarball"
+}
+
+# Set $source_tarball to the Slurm source tarball, from a release or a git
+# ref. Nothing is written under the topdir, so key can run before the RPM
+# set is restored into it from the runner's cache.
+get_source() {
+    if [ -n "$slurm_ref" ]; then
+        archive_ref
+    else
+        fetch_tarball
+    fi
+}
+
+# Pass rpmbuild output through while timing its phases from the markers it
+# logs, then write the breakdown in seconds to a JSON file. Phases whose
+# marker never shows up are recorded as zero.
+time_phases() {
+    gawk -v out="$1" '
+        BEGIN {
+            n = split("prep configure build install package compress", phase)
+            marker[1] = "^Executing\\(%prep\\)"
+            marker[2] = "^Executing\\(%build\\)"
+            marker[3] = "^\\+ (/usr/bin/)?make( |$)"
+            marker[4] = "^Executing\\(%install\\)"
+            marker[5] = "^Processing files:"
+            marker[6] = "^Checking for unpackaged file"
+            cur = 0
+            start = systime()
+        }
+        { print; fflush() }
+        {
+            for (i = cur + 1; i <= n; i++) {
+                if ($0 ~ marker[i]) {
+                    for (; cur < i; cur++)
+                        t[cur + 1] = systime()
+                    break
+                }
+            }
+        }
+        END {
+            for (; cur < n; cur++)
+                t[cur + 1] = systime()
+            t[n + 1] = systime()
+            printf "{" > out
+            for (i = 1; i <= n; i++) {
+                printf "%s\"%s\": %d", (i > 1 ? ", " : ""), phase[i], t[i + 1] - t[i] > out
+                printf "%-10s %6ds\n", phase[i], t[i + 1] - t[i]
+            }
+            printf ", \"total\": %d}\n", t[n + 1] - start > out
+        }'
+}
+
+# Run only %prep and configure with the options rpmbuild is about to get,
+# and fail unless config.status enables every feature slurm.features lists
+# for the flavor. A missing -devel package shows up here within a minute
+# rather than as a silently missing plugin after the full build.
+check_features() {
+    local check_spec="$topdir/SPECS/slurm-configure.spec" status
+    local feature flavors symbols symbol found missing=()
+
+    awk '/^%build/ { build = 1 }
+         build && !done && /^(make|%make_build|%\{__make\})/ { print "exit 0"; done = 1 }
+         { print }' "$spec" > "$check_spec"
+    if ! grep -qx "exit 0" "$check_spec"; then
+        echo "Cannot find the make call in %build of $spec" >&2
+        exit 1
+    fi
+    if ! rpmbuild -bc "$@" "$check_spec" > "$topdir/configure.log" 2>&1; then
+        tail -n 50 "$topdir/configure.log" >&2
+        exit 1
+    fi
+
+    # The lto flavor is only an A/B pair with the rest if -flto reaches the
+    # compiler exactly when its flags ask for it.
+    local want_lto="" got_lto=""
+    [[ "$*" != *-flto* ]] || want_lto=yes
+    if grep -qE "CFLAGS=.*-flto" "$topdir/configure.log"; then
+        got_lto=yes
+    fi
+    if [ "$want_lto" != "$got_lto" ]; then
+        echo "configure got LTO=${got_lto:-no} for a build that asked for ${want_lto:-no}" >&2
+        exit 1
+    fi
+
+    status="$(find "$topdir/BUILD" -name config.status -path "*/${tarball%.tar.bz2}/*" | head -n1)"
+    while read -r feature flavors symbols; do
+        [[ -n $feature && $feature != \#* ]] || continue
+        [[ $flavors == '*' || ",$flavors," == *",$flavor,"* ]] || continue
+        found=""
+        for symbol in $symbols; do
+            if grep -qE "^(D\[\"$symbol\"\]=\" 1\"|S\[\"${symbol}_TRUE\"\]=\"\")$" "$status"; then
+                found=1
+            fi
+        done
+        [ -n "$found" ] || missing+=("$feature")
+    done < "$(dirname "$0")/slurm.features"
+
+    if [ "${#missing[@]}" -gt 0 ]; then
+        echo "configure did not enable: ${missing[*]} (see $topdir/configure.log)" >&2
+        exit 1
+    fi
+}
+
+# Write the plugins each package of the RPM set ships to
+# plugin-manifest.json in the topdir.
+write_plugin_manifest() {
+    local rpm plugins sep=""
+
+    {
+        echo "{"
+        for rpm in "$topdir"/RPMS/*/*.rpm; do
+            plugins="$(rpm -qlp "$rpm" | sed -n "s|^$libdir/slurm/\(.*\)\.so$|\"\1\"|p" \
+                | paste -sd, | sed 's/,/, /g')"
+            [ -n "$plugins" ] || continue
+            printf '%s  "%s": [%s]' "$sep" "$(rpm -qp --qf '%{NAME}' "$rpm")" "$plugins"
+            sep=$',\n'
+        done
+        printf '\n}\n'
+    } > "$topdir/plugin-manifest.json"
+}
+
+# Run rpmbuild with the flavor's options, appending any extra compiler and
+# linker flags to the distro build flags. They go in through the
+# _distro_extra_* hooks so they are expanded in spec context, after the
+# flavor's and the spec's own macro overrides.
+build_rpms() {
+    local flags="$*"
+    local opts=("${repro_opts[@]}" --define "_smp_mflags -j$make_jobs")
+
+    if [ -n "$flags" ]; then
+        opts+=(--define "_distro_extra_cflags $flags"
+               --define "_distro_extra_cxxflags $flags"
+               --define "_distro_extra_ldflags $flags")
+    fi
+    check_features "${opts[@]}" "${rpmbuild_opts[@]}"
+    rpmbuild -ba "${opts[@]}" "${rpmbuild_opts[@]}" "$spec" 2>&1 \
+        | time_phases "$topdir/build-times.json"
+}
+
+# Drive an sbatch storm with mixed job sizes and time limits against the
+# cluster, so the scheduler and backfill loops run with a deep queue.
+pgo_train() {
+    local seconds="${PGO_TRAINING_SECONDS:-600}" end
+
+    seq 1 20000 | xargs -P 16 -I{} sh -c \
+        'sbatch --quiet -N $(({} % 8 + 1)) -t $(({} % 60 + 1)) --wrap "sleep $(({} % 10))"'
+    sbatch --quiet --array=1-20000 -t 5 --wrap "sleep 1"
+
+    end=$((SECONDS + seconds))
+    while [ "$SECONDS" -lt "$end" ]; do
+        squeue -h -t pending | wc -l
+        sinfo -h > /dev/null
+        sleep 10
+    done
+    scancel --user=root
+}
+
+# Build the RPM set for the flavor.
+build() {
+    get_source
+    mkdir -p "$topdir/SOURCES" "$topdir/SPECS"
+    cp "$source_tarball" "$topdir/SOURCES/$tarball"
+    # The newest file in the tarball stands in for the release date.
+    SOURCE_DATE_EPOCH="$(tar --list --verbose --full-time -f "$topdir/SOURCES/$tarball" \
+        | awk '{ print $4 " " $5 }' | sort | tail -n1 | date -f - +%s)"
+    export SOURCE_DATE_EPOCH
+    tar -xOf "$topdir/SOURCES/$tarball" "${tarball%.tar.bz2}/slurm.spec" > "$spec"
+
+    # Docs and man pages go to slurm-doc, which the base package only
+    # Recommends, so node images built without weak deps leave them out.
+    # Only Slurm's own files move: the directories belong to filesystem, and
+    # the pages the base package leaves to slurm-contribs and the other
+    # subpackages stay with them. Man section 3 is all slurm-perlapi's.
+    local others
+    others="$(grep '^%exclude %{_mandir}/' "$spec" || true)"
+    split_files doc "Slurm documentation and man pages" "" \
+        "%{_mandir}/man[158]/*" "%{_docdir}/%{name}*"
+    [ -z "$others" ] || echo "$others" >> "$spec"
+    sed -i '0,/^Release:.*/s//&\nRecommends: %{name}-doc = %{version}-%{release}/' "$spec"
+
+    case "$flavor" in
+        default)
+            ;;
+        pmix)
+            rpmbuild_opts+=(--with pmix --with ucx)
+            split_plugins pmix "Slurm PMIx plugin with UCX direct-connect" \
+                "pmix ucx" "mpi_pmix*.so"
+            ;;
+        pgo)
+            # Instrumented build on an emulated multi-node cluster. The
+            # profile build drops multiple_slurmd again, so the few functions
+            # that differ between the two lose their profile instead of
+            # failing the build.
+            profile_dir=/var/tmp/slurm-pgo
+            rpmbuild_opts+=(--with multiple_slurmd)
+            build_rpms -fprofile-generate="$profile_dir" -fprofile-update=atomic
+
+            cluster_install "$topdir" slurm slurm-slurmctld slurm-slurmd
+            cluster_start 16
+            pgo_train
+            cluster_stop
+            cluster_uninstall
+
+            rm -rf "$topdir/RPMS" "$topdir/SRPMS"
+            rpmbuild_opts=("${base_opts[@]}")
+            build_flags+=(-fprofile-use="$profile_dir" -fprofile-partial-training
+                          -Wno-missing-profile -Wno-error=coverage-mismatch)
+            ;;
+        lto)
+            # base_opts clears %_lto_cflags for every flavor, so LTO goes in
+            # as plain flags that neither the spec nor the distro default
+            # can switch off or double up.
+            build_flags+=(-flto=auto -ffat-lto-objects)
+            ;;
+        x86-64-v3|x86-64-v4)
+            require_arch x86_64
+            build_flags+=(-march="$flavor")
+            ;;
+        framepointer)
+            rpmbuild_opts+=(--define "_include_frame_pointers 1")
+            build_flags+=(-fno-omit-frame-pointer -mno-omit-leaf-frame-pointer)
+            ;;
+        nvml)
+            require_arch x86_64
+            rpmbuild_opts+=(--define "_with_nvml --with-nvml=/usr/local/cuda")
+            split_plugins gpu-nvml "Slurm NVML GPU plugin" "" gpu_nvml.so
+            ;;
+        symbolic)
+            # Bind calls inside libslurmfull and each plugin directly rather
+            # than through the PLT. -fvisibility=hidden is not an option:
+            # Slurm doesn't mark its exports, so plugins would lose the
+            # symbols dlsym looks up and libslurmfull its whole API. Nor is
+            # -z now: plugins reference symbols only some daemons define, so
+            # the spec links them -z lazy and they must stay that way.
+            build_flags+=(-fno-semantic-interposition -Wl,--hash-style=gnu
+                          -Wl,-Bsymbolic-functions)
+            ;;
+        tracing)
+            # Keep .symtab in the stripped binaries so uprobes can attach to
+            # lock_slurmctld, unlock_slurmctld and slurmctld_req by name.
+            rpmbuild_opts+=(--define "_include_frame_pointers 1"
+                            --define "_find_debuginfo_opts --keep-section .symtab")
+            build_flags+=(-fno-omit-frame-pointer -mno-omit-leaf-frame-pointer)
+            ;;
+        tsan)
+            build_flags+=(-fsanitize=thread -O1 -fno-omit-frame-pointer)
+            ;;
+        profiling)
+            # configure reads these like --with-ofed and --with-hdf5, so a
+            # missing library fails it instead of dropping the plugin.
+            with_ofed=yes with_hdf5=yes
+            split_plugins ofed "Slurm OFED interconnect accounting plugin" "" \
+                acct_gather_interconnect_ofed.so
+            split_plugins hdf5 "Slurm HDF5 job profiling plugin" "" \
+                acct_gather_profile_hdf5.so
+            ;;
+        multiple-slurmd)
+            rpmbuild_opts+=(--with multiple_slurmd)
+            ;;
+        *)
+            echo "Unknown flavor: $flavor" >&2
+            exit 1
+            ;;
+    esac
+
+    build_rpms "${build_flags[@]}"
+    rpmbuild -bb "${repro_opts[@]}" \
+        --define "slurm_version $slurm_version" \
+        "${base_opts[@]}" \
+        "$(dirname "$0")/slurm-jemalloc.spec"
+
+    # The exporter links against the libslurm just built, so it needs that
+    # set's slurm-devel installed while it builds.
+    cluster_install "$topdir" slurm slurm-devel
+    cp "$(dirname "$0")/slurm-exporter.c" "$topdir/SOURCES/"
+    rpmbuild -bb "${repro_opts[@]}" \
+        --define "slurm_version $slurm_version" \
+        "${base_opts[@]}" \
+        "$(dirname "$0")/slurm-exporter.spec"
+    cluster_uninstall
+    printf '%s\n' "${rpmbuild_opts[@]}" "${build_flags[@]}" > "$topdir/build-options"
+    write_plugin_manifest
+    ccache --show-stats
+}
+
+# Write a key for the RPM set the build command would produce to
+# $HOME/build-key: the source tarball, the builder image and the scripts
+# that pick the flavor's rpmbuild options. Sets with the same key are
+# identical, so a cached one can stand in for a rebuild.
+key() {
+    local dir
+    dir="$(dirname "$0")"
+
+    get_source
+    {
+        sha256sum "$source_tarball" | cut -d' ' -f1
+        echo "${IMAGE_ID:?IMAGE_ID is not set}"
+        printf '%s\n' "$flavor" "${rpmbuild_opts[@]}"
+        cat "$dir/entrypoint.sh" "$dir/cluster.sh" "$dir"/*.spec "$dir/slurm-exporter.c" \
+            "$dir/slurm.features"
+    } | sha256sum | cut -c1-16 | tee "$HOME/build-key"
+}
+
+# Benchmark the RPM set that an earlier build of the flavor left in its
+# topdir, writing JSON reports under $HOME/bench/<flavor>.
+bench() {
+    local report_dir="$HOME/bench/$flavor" nodes=1
+
+    if grep -qx multiple_slurmd "$topdir/build-options"; then
+        nodes="${BENCH_NODES:-16}"
+    fi
+    mkdir -p "$report_dir"
+
+    cluster_install "$topdir" slurm slurm-slurmctld slurm-slurmd slurm-slurmdbd \
+        slurm-slurmrestd slurm-pmix slurm-ofed slurm-hdf5
+    local bench=("$(dirname "$0")/bench.py" --nodes "$nodes" --flavor "$flavor"
+                 --slurm-version "$(rpm -q --qf '%{VERSION}' slurm)")
+    cluster_start "$nodes" dbd
+    "${bench[@]}" ctld > "$report_dir/ctld.json"
+    "${bench[@]}" dbd > "$report_dir/dbd.json"
+    cluster_start_restd
+    "${bench[@]}" restd > "$report_dir/restd.json"
+    cluster_stop
+    cp "$cluster_dir"/log/tsan.* "$report_dir/" 2>/dev/null || true
+
+    # Step launch latency on a single node for each plugin combination the
+    # build and the container allow. cgroup/v2 needs the bench command to
+    # run privileged.
+    local variants=(none affinity) variant
+    [ ! -w /sys/fs/cgroup/cgroup.subtree_control ] || variants+=(cgroup cgroup,affinity)
+    if [ -f "$libdir/slurm/mpi_pmix.so" ]; then
+        variants+=(pmix)
+        [ ! -w /sys/fs/cgroup/cgroup.subtree_control ] || variants+=(cgroup,affinity,pmix)
+    fi
+    for variant in "${variants[@]}"; do
+        cluster_start 1 "" "$variant"
+        "${bench[@]}" --nodes 1 steps --plugins "$variant" \
+            > "$report_dir/steps-${variant//,/+}.json"
+        # With devices constrained, every step attaches cgroup/v2's device
+        # filter; make sure the runner's kernel accepted it. Program IDs are
+        # global, so only the step's own cgroup tells Slurm's filter apart
+        # from the ones systemd and runc attach on the host.
+        if [[ $variant == cgroup* ]] && ! srun -n1 sh -c '
+                cg="$(sed -nE "s|^0::(.*/step_[^/]+).*|\1|p" /proc/self/cgroup)"
+                [ -n "$cg" ] && bpftool cgroup show "/sys/fs/cgroup$cg"' \
+                | grep -w cgroup_device > /dev/null; then
+            echo "cgroup/v2 did not load its eBPF device filter on $(uname -r)" >&2
+            cluster_stop
+            exit 1
+        fi
+        cluster_stop
+    done
+
+    # Per-node sampling cost of HDF5 task profiling at a range of
+    # frequencies, when the flavor ships it.
+    if [ -f "$libdir/slurm/acct_gather_profile_hdf5.so" ]; then
+        cluster_start 1 "" profile
+        "${bench[@]}" --nodes 1 profile --profile-dir "$cluster_dir/profile" \
+            > "$report_dir/profile.json"
+        cluster_stop
+    fi
+}
+
+# Boot a controller with SCALE_NODES nodes in slurm.conf, of which only the
+# first SCALE_LIVE_NODES run a slurmd, and measure how it copes with
+# restarts, reconfigures and registration storms at that size.
+scale() {
+    local report_dir="$HOME/bench/$flavor" nodes="${SCALE_NODES:-10000}"
+    local live="${SCALE_LIVE_NODES:-256}"
+
+    if ! grep -qx multiple_slurmd "$topdir/build-options"; then
+        echo "The scale command needs a flavor built --with multiple_slurmd" >&2
+        exit 1
+    fi
+    mkdir -p "$report_dir"
+
+    cluster_install "$topdir" slurm slurm-slurmctld slurm-slurmd
+    cluster_start "$nodes" "" "" "$live"
+    "$(dirname "$0")/bench.py" --nodes "$nodes" --flavor "$flavor" \
+        --slurm-version "$(rpm -q --qf '%{VERSION}' slurm)" \
+        scale --live "$live" > "$report_dir/scale.json"
+    cluster_stop
+}
+
+# Sign the RPM sets downloaded into $HOME/repo and turn each one into a dnf
+# repository. Without a signing key the repository is published unsigned.
+repo() {
+    local dir key_id=""
+
+    if [ -n "${RPM_SIGNING_KEY:-}" ]; then
+        gpg --batch --import <<< "$RPM_SIGNING_KEY"
+        key_id="$(gpg --list-secret-keys --with-colons | awk -F: '$1 == "sec" { print $5; exit }')"
+        find "$HOME/repo" -name '*.rpm' \
+            -exec rpmsign --define "_gpg_name $key_id" --addsign {} +
+        gpg --armor --export "$key_id" > "$HOME/repo/RPM-GPG-KEY-slurm"
+    else
+        echo "::warning::RPM_SIGNING_KEY is not set, publishing an unsigned repository"
+    fi
+
+    for dir in "$HOME"/repo/*/; do
+        createrepo_c "$dir"
+        if [ -n "$key_id" ]; then
+            gpg --batch --yes --armor --detach-sign -u "$key_id" \
+                "$dir/repodata/repomd.xml"
+        fi
+    done
+}
+
+# Check an RPM set built earlier in the job for the features every flavor
+# is expected to have.
+check() {
+    cluster_install "$topdir" slurm slurm-slurmd
+
+    if ! rpm -q --requires slurm slurm-slurmd | grep -q '^libhwloc'; then
+        echo "slurm is not linked against hwloc" >&2
+        exit 1
+    fi
+
+    local plugin_dir cgroup_v2 plugin
+    plugin_dir="$libdir/slurm"
+    cgroup_v2="$plugin_dir/cgroup_v2.so"
+    # serializer/json backs the --json output the bench stage parses.
+    for plugin in cgroup_v2 job_submit_lua cli_filter_lua serializer_json; do
+        if [ ! -f "$plugin_dir/$plugin.so" ]; then
+            echo "$plugin.so is missing from the slurm package" >&2
+            exit 1
+        fi
+    done
+
+    # cgroup/v2 also needs dbus for scope creation and the eBPF program for
+    # the device constraint; either missing leaves a plugin that can't be used.
+    if ! ldd "$cgroup_v2" | grep -q libdbus-1; then
+        echo "cgroup_v2.so is not linked against dbus" >&2
+        exit 1
+    fi
+    if ! nm -D --defined-only "$cgroup_v2" | grep -qw load_ebpf_prog; then
+        echo "cgroup_v2.so was built without the eBPF device program" >&2
+        exit 1
+    fi
+
+    # slurmd -C gets its layout from hwloc, so it must agree with lscpu.
+    local field expected actual
+    for field in "Socket(s):SocketsPerBoard" "Core(s) per socket:CoresPerSocket" \
+                 "Thread(s) per core:ThreadsPerCore"; do
+        expected="$(lscpu | awk -F: -v f="${field%:*}" '$1 == f { gsub(/ /, "", $2); print $2 }')"
+        actual="$(slurmd -C | grep -o "${field##*:}=[0-9]*" | cut -d= -f2)"
+        if [ "$expected" != "$actual" ]; then
+            echo "slurmd -C reports ${field##*:}=$actual, lscpu reports $expected" >&2
+            exit 1
+        fi
+    done
+    slurmd -C
+
+    # Record the payload size and how long rpm takes to unpack the whole set,
+    # to weigh compression settings against install time on the nodes.
+    local root=/var/tmp/payload-root rpms start elapsed
+    mapfile -t rpms < <(find "$topdir/RPMS" -name '*.rpm' ! -name '*debug*')
+    rm -rf "$root"
+    rpm --root "$root" --initdb
+    start="$EPOCHREALTIME"
+    rpm -i --root "$root" --nodeps --noscripts --notriggers "${rpms[@]}"
+    elapsed="$(awk -v a="$start" -v b="$EPOCHREALTIME" 'BEGIN { printf "%.2f", b - a }')"
+
+    mkdir -p "$HOME/bench/$flavor"
+    printf '{"payload": "%s", "packages": %d, "bytes": %d, "install_seconds": %s}\n' \
+        "$(rpm -qp --qf '%{PAYLOADCOMPRESSOR}:%{PAYLOADFLAGS}' "${rpms[0]}")" \
+        "${#rpms[@]}" "$(du -cb "${rpms[@]}" | tail -n1 | cut -f1)" "$elapsed" \
+        | tee "$HOME/bench/$flavor/payload.json"
+    rm -rf "$root"
+}
+
+# Every package in the set is built into the flavor's topdir with the build
+# times and build host pinned, so the same source and options give
+# byte-identical RPMs.
+repro_opts=(--define "_topdir $topdir" --define "dist $dist"
+            --define "_buildhost slurm-rpms-builder"
+            --define "source_date_epoch_from_changelog 0"
+            --define "use_source_date_epoch_as_buildtime 1"
+            --define "clamp_mtime_to_source_date_epoch 1")
+base_opts=(--with hwloc --with numa --with slurmrestd --with jwt --with yaml
+           --with lua)
+# Fedora turns LTO on by default; only the lto flavor gets it, so it can be
+# compared against everything else.
+base_opts+=(--define "_lto_cflags %{nil}")
+[ "$prefix" = /usr ] || base_opts+=(--define "_prefix $prefix")
+if [ -n "$zstd_level" ]; then
+    base_opts+=(--define "_binary_payload w${zstd_level}T${zstd_threads}.zstdio")
+fi
+rpmbuild_opts=("${base_opts[@]}")
+build_flags=()
+# rdma-core-devel and hdf5-devel are in the image for the profiling flavor.
+# Keep configure from building on them, and pulling their libraries into
+# the packages, everywhere else.
+export with_ofed=no with_hdf5=no
+
+case "${COMMAND:-build}" in
+    build)
+        build
+        ;;
+    key)
+        key
+        ;;
+    check)
+        check
+        ;;
+    bench)
+        bench
+        ;;
+    scale)
+        scale
+        ;;
+    repo)
+        repo
+        ;;
+    *)
+        echo "Unknown command: $COMMAND" >&2
+        exit 1
+        ;;
+esac
@@ -0,0 +1,212 @@
+/*
+ * Prometheus exporter for slurmctld scheduling statistics.
+ *
+ * Polls slurmctld for the same statistics sdiag shows once per interval and
+ * serves the last sample to every scrape, so the controller sees one RPC
+ * per interval no matter how many scrapers there are.
+ *
+ * Usage: slurm-exporter [-l address] [-p port] [-i seconds]
+ */
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <slurm/slurm.h>
+#include <slurm/slurm_errno.h>
+
+static char *body;
+static size_t body_len, body_size;
+
+static void emit(const char *fmt, ...)
+{
+	va_list ap;
+	int n;
+
+	for (;;) {
+		va_start(ap, fmt);
+		n = vsnprintf(body + body_len, body_size - body_len, fmt, ap);
+		va_end(ap);
+		if (n >= 0 && (size_t) n < body_size - body_len)
+			break;
+		body_size = body_size ? body_size * 2 : 65536;
+		if (!(body = realloc(body, body_size))) {
+			perror("realloc");
+			exit(1);
+		}
+	}
+	body_len += n;
+}
+
+static void metric(const char *name, const char *type, const char *help,
+		   unsigned long long value)
+{
+	emit("# HELP slurm_%s %s\n# TYPE slurm_%s %s\nslurm_%s %llu\n",
+	     name, help, name, type, name, value);
+}
+
+static void sample(void)
+{
+	stats_info_request_msg_t req = { .command_id = STAT_COMMAND_GET };
+	stats_info_response_msg_t *stats = NULL;
+	uint32_t i;
+
+	body_len = 0;
+	if (slurm_get_statistics(&stats, &req) != SLURM_SUCCESS) {
+		fprintf(stderr, "slurm_get_statistics: %s\n",
+			slurm_strerror(slurm_get_errno()));
+		metric("up", "gauge", "Whether slurmctld answered the last poll", 0);
+		return;
+	}
+	metric("up", "gauge", "Whether slurmctld answered the last poll", 1);
+
+	metric("server_threads", "gauge", "slurmctld RPC server threads",
+	       stats->server_thread_count);
+	metric("agent_queue_size", "gauge", "Outgoing RPCs queued in slurmctld",
+	       stats->agent_queue_size);
+	metric("dbd_agent_queue_size", "gauge",
+	       "Messages queued for slurmdbd in slurmctld",
+	       stats->dbd_agent_queue_size);
+
+	metric("schedule_cycles_total", "counter", "Main scheduler cycles",
+	       stats->schedule_cycle_counter);
+	metric("schedule_cycle_microseconds_total", "counter",
+	       "Time spent in main scheduler cycles",
+	       stats->schedule_cycle_sum);
+	metric("schedule_cycle_last_microseconds", "gauge",
+	       "Length of the last main scheduler cycle",
+	       stats->schedule_cycle_last);
+	metric("schedule_cycle_max_microseconds", "gauge",
+	       "Longest main scheduler cycle", stats->schedule_cycle_max);
+	metric("schedule_queue_length", "gauge",
+	       "Jobs in the main scheduler queue", stats->schedule_queue_len);
+
+	metric("backfill_cycles_total", "counter", "Backfill scheduler cycles",
+	       stats->bf_cycle_counter);
+	metric("backfill_cycle_microseconds_total", "counter",
+	       "Time spent in backfill scheduler cycles", stats->bf_cycle_sum);
+	metric("backfill_cycle_last_microseconds", "gauge",
+	       "Length of the last backfill cycle", stats->bf_cycle_last);
+	metric("backfill_cycle_max_microseconds", "gauge",
+	       "Longest backfill cycle", stats->bf_cycle_max);
+	metric("backfilled_jobs_total", "counter",
+	       "Jobs started by the backfill scheduler",
+	       stats->bf_backfilled_jobs);
+
+	metric("jobs_submitted_total", "counter", "Jobs submitted",
+	       stats->jobs_submitted);
+	metric("jobs_started_total", "counter", "Jobs started",
+	       stats->jobs_started);
+	metric("jobs_completed_total", "counter", "Jobs completed",
+	       stats->jobs_completed);
+
+	/*
+	 * Counts and total time per message type, so rate(time) / rate(count)
+	 * gives the mean handling latency over any window.
+	 */
+	emit("# HELP slurm_rpcs_total RPCs handled by slurmctld\n"
+	     "# TYPE slurm_rpcs_total counter\n");
+	for (i = 0; i < stats->rpc_type_size; i++)
+		emit("slurm_rpcs_total{type=\"%u\"} %u\n",
+		     stats->rpc_type_id[i], stats->rpc_type_cnt[i]);
+	emit("# HELP slurm_rpc_microseconds_total Time slurmctld spent handling RPCs\n"
+	     "# TYPE slurm_rpc_microseconds_total counter\n");
+	for (i = 0; i < stats->rpc_type_size; i++)
+		emit("slurm_rpc_microseconds_total{type=\"%u\"} %llu\n",
+		     stats->rpc_type_id[i],
+		     (unsigned long long) stats->rpc_type_time[i]);
+
+	slurm_free_stats_response_msg(stats);
+}
+
+static void serve(int fd)
+{
+	struct timeval timeout = { .tv_sec = 5 };
+	char req[1024], head[256];
+	int n;
+
+	/*
+	 * Every path gets the metrics, so the request is read but not parsed.
+	 * The timeout keeps one stuck client from stalling the poll loop.
+	 */
+	setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+	setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+	if (read(fd, req, sizeof(req)) >= 0) {
+		n = snprintf(head, sizeof(head),
+			     "HTTP/1.0 200 OK\r\n"
+			     "Content-Type: text/plain; version=0.0.4\r\n"
+			     "Content-Length: %zu\r\n\r\n", body_len);
+		if (write(fd, head, n) == n && write(fd, body, body_len) < 0)
+			perror("write");
+	}
+	close(fd);
+}
+
+int main(int argc, char **argv)
+{
+	const char *addr = "0.0.0.0";
+	int port = 9341, interval = 15, opt, sock, one = 1;
+	struct sockaddr_in sin = { .sin_family = AF_INET };
+	struct pollfd pfd;
+	time_t next = 0;
+
+	while ((opt = getopt(argc, argv, "l:p:i:")) != -1) {
+		switch (opt) {
+		case 'l':
+			addr = optarg;
+			break;
+		case 'p':
+			port = atoi(optarg);
+			break;
+		case 'i':
+			interval = atoi(optarg);
+			break;
+		default:
+			fprintf(stderr, "Usage: %s [-l address] [-p port] [-i seconds]\n",
+				argv[0]);
+			return 2;
+		}
+	}
+
+	slurm_init(NULL);
+
+	sin.sin_port = htons(port);
+	if (inet_pton(AF_INET, addr, &sin.sin_addr) != 1) {
+		fprintf(stderr, "Invalid listen address: %s\n", addr);
+		return 2;
+	}
+	if ((sock = socket(AF_INET, SOCK_STREAM, 0)) < 0 ||
+	    setsockopt(sock, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one)) ||
+	    bind(sock, (struct sockaddr *) &sin, sizeof(sin)) ||
+	    listen(sock, 16)) {
+		perror("listen");
+		return 1;
+	}
+
+	pfd.fd = sock;
+	pfd.events = POLLIN;
+	for (;;) {
+		time_t now = time(NULL);
+		int fd;
+
+		if (now >= next) {
+			sample();
+			next = now + interval;
+		}
+		if (poll(&pfd, 1, (next - now) * 1000) <= 0)
+			continue;
+		if ((fd = accept(sock, NULL, NULL)) >= 0)
+			serve(fd);
+		else if (errno != EINTR)
+			perror("accept");
+	}
+}
@@ -0,0 +1,45 @@
+Name:		slurm-exporter
+Version:	%{slurm_version}
+Release:	1%{?dist}
+Summary:	Prometheus exporter for slurmctld scheduling statistics
+License:	GPL-2.0-or-later
+Source0:	slurm-exporter.c
+BuildRequires:	gcc
+BuildRequires:	slurm-devel = %{version}
+Requires:	slurm%{?_isa} = %{version}
+
+%description
+Serves slurmctld's scheduler cycle times, per message type RPC counts and
+handling time, and the DBD agent queue depth in the Prometheus text format.
+It polls slurmctld once per interval however often it is scraped.
+
+%prep
+cp %{SOURCE0} .
+
+%build
+gcc %{optflags} -I%{_includedir} %{build_ldflags} -L%{_libdir} \
+%if "%{_prefix}" != "/usr"
+	-Wl,-rpath,%{_libdir} \
+%endif
+	-o slurm-exporter slurm-exporter.c -lslurm
+
+%install
+install -D -m 755 slurm-exporter %{buildroot}%{_sbindir}/slurm-exporter
+mkdir -p %{buildroot}%{_unitdir}
+cat > %{buildroot}%{_unitdir}/slurm-exporter.service <<EOF
+[Unit]
+Description=Prometheus exporter for slurmctld statistics
+After=network-online.target
+
+[Service]
+ExecStart=%{_sbindir}/slurm-exporter
+DynamicUser=yes
+Restart=on-failure
+
+[Install]
+WantedBy=multi-user.target
+EOF
+
+%files
+%{_sbindir}/slurm-exporter
+%{_unitdir}/slurm-exporter.service